@@ -86,8 +86,8 @@ enum MemoryManagementDomain {
 										*/
 	MemoryManagementDomainUnmanaged,	/*!< Option indicating that the copy
 										 should not be managed by the memory
-										 management module but directly by
-										 free(3)
+										 management module: release it with
+										 memory_management_free_unmanaged()
 										 */
 	MemoryManagementDomains
 };
@@ -239,6 +239,98 @@ void memory_management_release(void *object) __attribute__((nonnull (1)));
  */
 unsigned int memory_management_get_retain_count(const void *object) __attribute__((nonnull (1)));
 
+/*!
+ *  @fn size_t memory_management_get_size(const void *object) __attribute__((nonnull (1)))
+ *  @brief Gets the size of a managed object.
+ *  @ingroup mm
+ *	@public
+ *	@param[in] object the object
+ *	@returns the size requested when the object was allocated, 0 with errno set to **EFAULT** if the object is not managed.
+ */
+size_t memory_management_get_size(const void *object) __attribute__((nonnull (1)));
+
+/*!
+ *  @struct memory_management_slice
+ *	@brief A view on a range of a managed object.
+ *  @ingroup mm
+ *	@public
+ *	@details A slice retains the managed object it views, the object is freed
+ *	only when its last slice and its last owner have released it. Slices are
+ *	values: making one neither allocates nor copies the bytes.
+ */
+typedef struct memory_management_slice {
+	void *buffer; /*!< the viewed managed object, `NULL` for an invalid slice */
+	size_t offset; /*!< the start of the range in the buffer */
+	size_t length; /*!< the length of the range */
+} MemoryManagementSlice;
+
+/*!
+ *  @def MEMORY_MANAGEMENT_SLICE_BYTES(slice)
+ *	@brief Gets the first byte of a slice.
+ *  @ingroup mm
+ *	@public
+ *	@returns a pointer into the buffer of the slice
+ */
+#define MEMORY_MANAGEMENT_SLICE_BYTES(slice) ((void *)((char *)(slice).buffer + (slice).offset))
+
+/*!
+ *  @fn MemoryManagementSlice memory_management_slice(void *buffer, size_t offset, size_t length) __attribute__((nonnull (1)))
+ *  @brief Makes a slice on a range of a managed object.
+ *  @ingroup mm
+ *	@public
+ *	@param[in] buffer the managed object, it is retained
+ *	@param[in] offset the start of the range
+ *	@param[in] length the length of the range
+ *	@returns the slice. If there is an error, its buffer is `NULL` and errno is set to **EFAULT** if buffer is not managed or **EINVAL** if the range does not fit in it.
+ */
+MemoryManagementSlice memory_management_slice(void *buffer, size_t offset, size_t length) __attribute__((nonnull (1)));
+
+/*!
+ *  @fn MemoryManagementSlice memory_management_slice_subslice(MemoryManagementSlice slice, size_t offset, size_t length)
+ *  @brief Makes a slice on a range of a slice.
+ *  @ingroup mm
+ *	@public
+ *	@details The new slice retains the buffer of `slice` directly.
+ *	@param[in] slice the slice
+ *	@param[in] offset the start of the range in the slice
+ *	@param[in] length the length of the range
+ *	@returns the slice. If there is an error, its buffer is `NULL` and errno is set to **EINVAL** if the range does not fit in `slice` or **EFAULT** if its buffer was freed.
+ */
+MemoryManagementSlice memory_management_slice_subslice(MemoryManagementSlice slice, size_t offset, size_t length);
+
+/*!
+ *  @fn MemoryManagementSlice memory_management_slice_retain(MemoryManagementSlice slice)
+ *  @brief Retains the buffer of a slice.
+ *  @ingroup mm
+ *	@public
+ *	@param[in] slice the slice
+ *	@returns slice
+ */
+MemoryManagementSlice memory_management_slice_retain(MemoryManagementSlice slice);
+
+/*!
+ *  @fn void memory_management_slice_release(MemoryManagementSlice slice)
+ *  @brief Releases the buffer of a slice.
+ *  @ingroup mm
+ *	@public
+ *	@param[in] slice the slice
+ */
+void memory_management_slice_release(MemoryManagementSlice slice);
+
+/*!
+ *  @fn void *memory_management_slice_copy(MemoryManagementSlice slice, MemoryManagementDomain domain) __attribute__ ((malloc))
+ *  @brief Copies the bytes of a slice.
+ *  @ingroup mm
+ *	@public
+ *	@param[in] slice the slice
+ *	@details A zero-length slice is valid but has nothing to copy: like
+ *	@ref memory_management_alloc with a size of 0 this function then returns
+ *	`NULL` and sets errno to **EINVAL**.
+ *	@param[in] domain how the copy should be made
+ *	@returns  If successful this function return a pointer to allocated memory. If there is an error, they return a `NULL` pointer and set errno to **ENOMEM**, **EINVAL** for an invalid or zero-length slice, or **EFAULT** if the buffer of the slice was freed.
+ */
+void *memory_management_slice_copy(MemoryManagementSlice slice, MemoryManagementDomain domain) __attribute__ ((malloc));
+
 /*!
  *  @typedef typedef void (*deallocf)(void *) __attribute__((nonnull (1)))
  *  @brief The prototype of a dealloc function.
@@ -258,6 +350,51 @@ typedef void (*deallocf)(void *) __attribute__((nonnull (1)));
  */
 void memory_management_attributes_set_dealloc_function(void *object, deallocf function) __attribute__((nonnull (1)));
 
+/*!
+ *  @struct mm_allocator
+ *	@brief The backing allocator of the memory management module
+ *  @ingroup mm
+ *	@public
+ *	@details Every allocation and deallocation of the library goes through
+ *	these hooks. `alloc` and `free` are mandatory. Without `zeroed_alloc` the
+ *	library clears the memory returned by `alloc`, without `sized_free` it
+ *	calls `free`.
+ */
+struct mm_allocator {
+	void *(*alloc)(size_t size, void *context); /*!< allocates `size` bytes, like malloc(3) */
+	void *(*zeroed_alloc)(size_t size, void *context); /*!< allocates `size` zeroed bytes, like calloc(3) */
+	void (*free)(void *pointer, void *context); /*!< frees a pointer, like free(3) */
+	void (*sized_free)(void *pointer, size_t size, void *context); /*!< frees a pointer of `size` bytes, the size requested when it was allocated */
+	void *context; /*!< passed to every hook */
+};
+
+/*!
+ *	@fn void memory_management_set_allocator(const struct mm_allocator *allocator)
+ *	@brief Sets the backing allocator of the memory management module.
+ *	@ingroup mm
+ *	@public
+ *	@details The hooks are copied. Sets errno to **EINVAL** if `alloc` or
+ *	`free` is missing.
+ *	@param[in] allocator the allocator or `NULL` to restore malloc(3), calloc(3) and free(3)
+ *	@warning Objects are freed with the allocator installed when they are
+ *	released, not when they were allocated. Change the allocator before any
+ *	allocation or when no object from the previous one is alive.
+ */
+void memory_management_set_allocator(const struct mm_allocator *allocator);
+
+/*!
+ *	@fn void memory_management_free_unmanaged(void *object, size_t size)
+ *	@brief Frees an unmanaged copy made by @ref memory_management_copy or @ref memory_management_slice_copy.
+ *	@ingroup mm
+ *	@public
+ *	@details The copy is given back to the installed allocator through its
+ *	`sized_free` hook, or its `free` hook without one. With the default
+ *	allocator this is free(3).
+ *	@param[in] object the unmanaged copy or `NULL`
+ *	@param[in] size the size of the copy
+ */
+void memory_management_free_unmanaged(void *object, size_t size);
+
 /*!
  *	@fn void memory_management_print_stats()
  *	@brief Print the current stats of the memory management library.
@@ -267,6 +404,140 @@ void memory_management_attributes_set_dealloc_function(void *object, deallocf fu
  */
 void memory_management_print_stats(void);
 
+/*!
+ *	@fn void memory_management_guard_set_sample_rate(unsigned int rate)
+ *	@brief Places one in every `rate` allocations between guard pages.
+ *	@ingroup mm
+ *	@public
+ *	@details A sampled allocation is placed at the end of its own page, right
+ *	before an inaccessible guard page. When its reference count reaches 0 the
+ *	page is made inaccessible and kept in quarantine until its slot is reused.
+ *	An overflow or a use after the final release then crashes immediately and
+ *	the allocation and release stacks are printed on the standard error.
+ *
+ *	Only allocations that fit in a page are sampled and at most
+ *	`MEMORY_MANAGEMENT_GUARD_SLOTS` (64 by default) sampled objects are live
+ *	at the same time; the other allocations are served as usual. The rate can
+ *	also be set with the `MEMORY_MANAGEMENT_GUARD_SAMPLE_RATE` environment
+ *	variable.
+ *	@param[in] rate the sampling rate, 0 disables sampling (the default)
+ *	@warning The library installs its own `SIGSEGV` and `SIGBUS` handlers the
+ *	first time sampling is enabled. Faults outside of the guard pool are passed
+ *	on to the previous handlers.
+ */
+void memory_management_guard_set_sample_rate(unsigned int rate);
+
+/*!
+ *  @typedef typedef struct _memory_management_persistent_domain *MemoryManagementPersistentDomain
+ *  @brief A domain whose objects live in a memory mapped file.
+ *  @ingroup mm
+ *	@public
+ *	@details The objects of a persistent domain have the same header as any
+ *	managed object: @ref retain, @ref release and @ref memory_management_copy
+ *	work on them unchanged. When their reference count reaches 0 their block
+ *	returns to the file. The file is always mapped at the same address so the
+ *	objects can point to each other.
+ */
+typedef struct _memory_management_persistent_domain *MemoryManagementPersistentDomain;
+
+/*!
+ *  @fn MemoryManagementPersistentDomain memory_management_persistent_domain_open(const char *path, size_t capacity, void *address) __attribute__((nonnull (1)))
+ *  @brief Opens or creates a persistent domain.
+ *  @ingroup mm
+ *	@public
+ *	@details If the file is empty or does not exist it is created with the
+ *	given capacity and mapped at `address`. Otherwise the file is mapped at
+ *	the address it was created at, its headers are validated through their
+ *	canary and `size` and its live objects are adopted: their reference
+ *	counts are kept but their dealloc functions are reset since functions do
+ *	not survive a restart. Blocks that a crashed process was allocating or
+ *	releasing are given back to the domain. The file is locked while the
+ *	domain is open: any other open of it, from this process or another one,
+ *	fails with **EWOULDBLOCK**.
+ *	@param[in] path the backing file
+ *	@param[in] capacity the size of a new file, ignored for an existing one
+ *	@param[in] address the address of a new mapping or `NULL` to let the system choose, ignored for an existing file
+ *	@returns the domain or `NULL` with errno set to **EILSEQ** if the file is corrupted, **EADDRNOTAVAIL** if it cannot be mapped at its address, **EMFILE** if `MEMORY_MANAGEMENT_PERSISTENT_DOMAINS` (16 by default) domains are already open, or to the error of the failing system call.
+ */
+MemoryManagementPersistentDomain memory_management_persistent_domain_open(const char *path, size_t capacity, void *address) __attribute__((nonnull (1)));
+
+/*!
+ *  @fn void *memory_management_persistent_domain_alloc(MemoryManagementPersistentDomain domain, size_t size) __attribute__ ((malloc,nonnull (1)))
+ *  @brief Allocates a managed instance of the specified size in a persistent domain.
+ *  @ingroup mm
+ *	@public
+ *	@param[in] domain the domain
+ *	@param[in] size the size to be allocated
+ *	@returns  If successful this function return a pointer to allocated memory. If there is an error, they return a `NULL` pointer and set errno to **ENOMEM**.
+ */
+void *memory_management_persistent_domain_alloc(MemoryManagementPersistentDomain domain, size_t size) __attribute__ ((malloc,nonnull (1)));
+
+/*!
+ *  @fn void memory_management_persistent_domain_set_root(MemoryManagementPersistentDomain domain, void *object) __attribute__((nonnull (1)))
+ *  @brief Records the object from which the others are found after a restart.
+ *  @ingroup mm
+ *	@public
+ *	@details The root does not retain the object, it is cleared when the object is freed.
+ *	@param[in] domain the domain
+ *	@param[in] object an object of the domain or `NULL`
+ */
+void memory_management_persistent_domain_set_root(MemoryManagementPersistentDomain domain, void *object) __attribute__((nonnull (1)));
+
+/*!
+ *  @fn void *memory_management_persistent_domain_get_root(MemoryManagementPersistentDomain domain) __attribute__((nonnull (1)))
+ *  @brief Gets the root object of a persistent domain.
+ *  @ingroup mm
+ *	@public
+ *	@param[in] domain the domain
+ *	@returns the root object or `NULL`
+ */
+void *memory_management_persistent_domain_get_root(MemoryManagementPersistentDomain domain) __attribute__((nonnull (1)));
+
+/*!
+ *  @fn bool memory_management_persistent_domain_verify(MemoryManagementPersistentDomain domain) __attribute__((nonnull (1)))
+ *  @brief Checks the integrity of the headers of a persistent domain.
+ *  @ingroup mm
+ *	@public
+ *	@param[in] domain the domain
+ *	@details Every block must have a valid canary and `size`, every link of
+ *	the free lists must lead to a free block of the right size exactly once
+ *	and the root must be a live object.
+ *	@returns a boolean indicating whether the domain is intact. If not, errno is set to **EILSEQ**, or to **ENOMEM** if the check could not be made.
+ */
+bool memory_management_persistent_domain_verify(MemoryManagementPersistentDomain domain) __attribute__((nonnull (1)));
+
+/*!
+ *  @fn void memory_management_persistent_domain_enumerate(MemoryManagementPersistentDomain domain, void (*function)(void *object, void *context), void *context) __attribute__((nonnull (1,2)))
+ *  @brief Calls a function on every live object of a persistent domain.
+ *  @ingroup mm
+ *	@public
+ *	@details Useful to set the dealloc functions again after a restart. The
+ *	function must not allocate or free objects of the domain.
+ *	@param[in] domain the domain
+ *	@param[in] function the function to call
+ *	@param[in] context passed to the function
+ */
+void memory_management_persistent_domain_enumerate(MemoryManagementPersistentDomain domain, void (*function)(void *object, void *context), void *context) __attribute__((nonnull (1,2)));
+
+/*!
+ *  @fn void memory_management_persistent_domain_sync(MemoryManagementPersistentDomain domain) __attribute__((nonnull (1)))
+ *  @brief Writes the objects of a persistent domain to its file.
+ *  @ingroup mm
+ *	@public
+ *	@param[in] domain the domain
+ */
+void memory_management_persistent_domain_sync(MemoryManagementPersistentDomain domain) __attribute__((nonnull (1)));
+
+/*!
+ *  @fn void memory_management_persistent_domain_close(MemoryManagementPersistentDomain domain) __attribute__((nonnull (1)))
+ *  @brief Syncs and unmaps a persistent domain.
+ *  @ingroup mm
+ *	@public
+ *	@warning The objects of the domain must not be used after this call.
+ *	@param[in] domain the domain
+ */
+void memory_management_persistent_domain_close(MemoryManagementPersistentDomain domain) __attribute__((nonnull (1)));
+
 #ifdef __cplusplus
 }
 #endif /* _cplusplus */
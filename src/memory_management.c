@@ -24,14 +24,24 @@
  *
  */
 
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+#define _DARWIN_C_SOURCE /* MAP_ANONYMOUS */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 #include <memory_management/memory_management.h>
 #include <errno.h>
+#include <signal.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -79,6 +89,26 @@ pthread_mutex_t guardian = PTHREAD_MUTEX_INITIALIZER;
 
 #endif /* DEBUG */
 
+#ifndef MEMORY_MANAGEMENT_GUARD_SLOTS
+#define MEMORY_MANAGEMENT_GUARD_SLOTS 64
+#endif
+
+#ifndef MEMORY_MANAGEMENT_GUARD_STACK_DEPTH
+#define MEMORY_MANAGEMENT_GUARD_STACK_DEPTH 16
+#endif
+
+#define _MEMORY_MANAGEMENT_GUARD_ALIGNMENT 16
+#define _MEMORY_MANAGEMENT_GUARD_SAMPLE_RATE_VARIABLE "MEMORY_MANAGEMENT_GUARD_SAMPLE_RATE"
+
+#ifndef MEMORY_MANAGEMENT_PERSISTENT_DOMAINS
+#define MEMORY_MANAGEMENT_PERSISTENT_DOMAINS 16
+#endif
+
+#define _MEMORY_MANAGEMENT_PERSISTENT_MAGIC 0x4D4D5044 /* MMPD */
+#define _MEMORY_MANAGEMENT_PERSISTENT_VERSION 1
+#define _MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE 32
+#define _MEMORY_MANAGEMENT_PERSISTENT_BINS (sizeof(size_t) * 8 - 5)
+
 /*!
  *	@internal
  *  @struct _memory_management_attributes_internal
@@ -101,6 +131,786 @@ _MEMORY_MANAGEMENT_INTERNAL_TYPE _MEMORY_MANAGEMENT_PROTOTYPE_INTERNAL = {
 	0
 };
 
+static void *_memory_management_default_alloc(size_t size, void *context) {
+	(void)context;
+	return malloc(size);
+}
+
+static void *_memory_management_default_zeroed_alloc(size_t size, void *context) {
+	(void)context;
+	return calloc(1, size);
+}
+
+static void _memory_management_default_free(void *pointer, void *context) {
+	(void)context;
+	free(pointer);
+}
+
+static const struct mm_allocator _memory_management_default_allocator = {
+	_memory_management_default_alloc,
+	_memory_management_default_zeroed_alloc,
+	_memory_management_default_free,
+	NULL,
+	NULL
+};
+
+static struct mm_allocator _memory_management_allocator = {
+	_memory_management_default_alloc,
+	_memory_management_default_zeroed_alloc,
+	_memory_management_default_free,
+	NULL,
+	NULL
+};
+
+static void *_memory_management_allocator_zeroed_alloc(size_t size) {
+	if (NULL != _memory_management_allocator.zeroed_alloc)
+		return _memory_management_allocator.zeroed_alloc(size, _memory_management_allocator.context);
+	
+	void *pointer = _memory_management_allocator.alloc(size, _memory_management_allocator.context);
+	if (NULL != pointer)
+		memset(pointer, 0, size);
+	return pointer;
+}
+
+static void _memory_management_allocator_free(void *pointer, size_t size) {
+	if (NULL != _memory_management_allocator.sized_free)
+		_memory_management_allocator.sized_free(pointer, size, _memory_management_allocator.context);
+	else
+		_memory_management_allocator.free(pointer, _memory_management_allocator.context);
+}
+
+void memory_management_set_allocator(const struct mm_allocator *allocator) {
+	if (NULL == allocator) {
+		_memory_management_allocator = _memory_management_default_allocator;
+		return;
+	}
+	if (NULL == allocator->alloc || NULL == allocator->free) {
+		errno = EINVAL;
+		return;
+	}
+	_memory_management_allocator = *allocator;
+}
+
+void memory_management_free_unmanaged(void *object, size_t size) {
+	if (NULL == object)
+		return;
+	_memory_management_allocator_free(object, size);
+}
+
+/*!
+ *	@internal
+ *  @enum _memory_management_guard_slot_state
+ *	@brief The state of a slot of the guard pool
+ *  @ingroup mm
+ *	@endinternal
+ */
+enum _memory_management_guard_slot_state {
+	_MemoryManagementGuardSlotFree = 0,	/*!< the slot was never used */
+	_MemoryManagementGuardSlotLive,		/*!< the slot holds a live object */
+	_MemoryManagementGuardSlotQuarantined	/*!< the slot holds a released object and is inaccessible */
+};
+
+/*!
+ *	@internal
+ *  @struct _memory_management_guard_slot
+ *	@brief The bookkeeping of a sampled allocation
+ *  @ingroup mm
+ *	@details Each slot owns one page of the guard pool. The page is surrounded
+ *	by two inaccessible guard pages.
+ *	@endinternal
+ */
+struct _memory_management_guard_slot {
+	enum _memory_management_guard_slot_state state; /*!< the state of the slot */
+	char *object; /*!< the user pointer of the sampled object */
+	size_t size; /*!< the size requested by the user */
+	int allocStackDepth; /*!< the number of frames in allocStack */
+	int freeStackDepth; /*!< the number of frames in freeStack */
+	void *allocStack[MEMORY_MANAGEMENT_GUARD_STACK_DEPTH]; /*!< the stack of the allocation */
+	void *freeStack[MEMORY_MANAGEMENT_GUARD_STACK_DEPTH]; /*!< the stack of the final release */
+};
+
+static volatile unsigned int _memory_management_guard_sample_rate = 0;
+static __thread unsigned int _memory_management_guard_countdown = 0;
+
+static char *volatile _memory_management_guard_pool = NULL;
+static size_t _memory_management_guard_pool_length = 0;
+static size_t _memory_management_guard_page_size = 0;
+static unsigned int _memory_management_guard_next_slot = 0;
+static struct _memory_management_guard_slot _memory_management_guard_slots[MEMORY_MANAGEMENT_GUARD_SLOTS];
+static pthread_mutex_t _memory_management_guard_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct sigaction _memory_management_guard_previous_segv;
+static struct sigaction _memory_management_guard_previous_bus;
+
+static void _memory_management_guard_report(char *address) {
+	char *pool = _memory_management_guard_pool;
+	const size_t pageSize = _memory_management_guard_page_size;
+	const size_t page = (size_t)(address - pool) / pageSize;
+	const struct _memory_management_guard_slot *slot = NULL;
+	const char *kind = "invalid access";
+	
+	if (page % 2 == 1) {
+		slot = &_memory_management_guard_slots[(page - 1) / 2];
+		if (_MemoryManagementGuardSlotQuarantined == slot->state)
+			kind = "use-after-free";
+	}
+	else {
+		/* A guard page: blame the object that ends on its left, objects are
+		 placed at the end of their page. */
+		const size_t left = page / 2 - 1, right = page / 2;
+		if (page > 0 && _MemoryManagementGuardSlotFree != _memory_management_guard_slots[left].state) {
+			slot = &_memory_management_guard_slots[left];
+			kind = "buffer-overflow";
+		}
+		else if (right < MEMORY_MANAGEMENT_GUARD_SLOTS && _MemoryManagementGuardSlotFree != _memory_management_guard_slots[right].state) {
+			slot = &_memory_management_guard_slots[right];
+			kind = "buffer-underflow";
+		}
+	}
+	
+	const int pid = (int)getpid();
+	if (NULL == slot || _MemoryManagementGuardSlotFree == slot->state) {
+		dprintf(STDERR_FILENO, "==%d== GUARD: %s at %p\n", pid, kind, (void *)address);
+		return;
+	}
+	
+	dprintf(STDERR_FILENO, "==%d== GUARD: %s at %p of the %zu bytes object at %p\n", pid, kind, (void *)address, slot->size, (void *)slot->object);
+	dprintf(STDERR_FILENO, "==%d== allocated at:\n", pid);
+	backtrace_symbols_fd(slot->allocStack, slot->allocStackDepth, STDERR_FILENO);
+	if (0 < slot->freeStackDepth) {
+		dprintf(STDERR_FILENO, "==%d== freed at:\n", pid);
+		backtrace_symbols_fd(slot->freeStack, slot->freeStackDepth, STDERR_FILENO);
+	}
+}
+
+static void _memory_management_guard_signal_handler(int signal, siginfo_t *info, void *context) {
+	const struct sigaction *previous = (SIGBUS == signal) ? &_memory_management_guard_previous_bus : &_memory_management_guard_previous_segv;
+	char *address = info->si_addr;
+	char *pool = _memory_management_guard_pool;
+	const bool inPool = (NULL != pool && address >= pool && address < pool + _memory_management_guard_pool_length);
+	
+	if (!inPool && (previous->sa_flags & SA_SIGINFO)) {
+		/* Not ours: chain without uninstalling so that faults the application
+		 recovers from do not turn the reports off. */
+		previous->sa_sigaction(signal, info, context);
+		return;
+	}
+	if (!inPool && SIG_DFL != previous->sa_handler && SIG_IGN != previous->sa_handler) {
+		previous->sa_handler(signal);
+		return;
+	}
+	
+	if (inPool)
+		_memory_management_guard_report(address);
+	
+	/* Crash with the previous disposition: returning re-executes the faulting
+	 instruction. */
+	sigaction(signal, previous, NULL);
+}
+
+/* Must be called with _memory_management_guard_lock held */
+static bool _memory_management_guard_initialize_pool(void) {
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	if (pageSize <= 0)
+		return false;
+	
+	/* guard | slot | guard | slot | ... | slot | guard */
+	const size_t length = (2 * MEMORY_MANAGEMENT_GUARD_SLOTS + 1) * (size_t)pageSize;
+	void *pool = mmap(NULL, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == pool)
+		return false;
+	
+	/* The first call to backtrace(3) may load libraries and allocate, do it
+	 now instead of in the middle of an allocation. */
+	void *warmup[1];
+	backtrace(warmup, 1);
+	
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = _memory_management_guard_signal_handler;
+	/* Stay usable by crash handlers that run on an alternate stack */
+	action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGSEGV, &action, &_memory_management_guard_previous_segv);
+	sigaction(SIGBUS, &action, &_memory_management_guard_previous_bus);
+	
+	_memory_management_guard_page_size = (size_t)pageSize;
+	_memory_management_guard_pool_length = length;
+	_memory_management_guard_pool = pool;
+	return true;
+}
+
+static inline bool _memory_management_guard_should_sample(unsigned int rate) {
+	if (0 == _memory_management_guard_countdown || _memory_management_guard_countdown > rate)
+		_memory_management_guard_countdown = rate;
+	return 0 == --_memory_management_guard_countdown;
+}
+
+static _MEMORY_MANAGEMENT_INTERNAL_TYPE *_memory_management_guard_alloc(size_t totalSize) {
+	const size_t pageSize = _memory_management_guard_page_size;
+	const size_t userSize = totalSize - sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE);
+	/* Small objects cannot need more alignment than their size, aligning
+	 them less lets overflows hit the guard page sooner. The header in front
+	 of the object still needs pointer alignment. */
+	size_t alignment = sizeof(void *);
+	while (alignment < userSize && alignment < _MEMORY_MANAGEMENT_GUARD_ALIGNMENT)
+		alignment <<= 1;
+	const size_t alignedUserSize = (userSize + alignment - 1) & ~(alignment - 1);
+	if (alignedUserSize > pageSize - sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE))
+		return NULL;
+	
+	pthread_mutex_lock(&_memory_management_guard_lock);
+	/* Reuse slots round-robin so that released objects stay quarantined for
+	 as long as possible. */
+	unsigned int index = _memory_management_guard_next_slot, tries = 0;
+	while (tries < MEMORY_MANAGEMENT_GUARD_SLOTS && _MemoryManagementGuardSlotLive == _memory_management_guard_slots[index].state) {
+		index = (index + 1) % MEMORY_MANAGEMENT_GUARD_SLOTS;
+		tries++;
+	}
+	
+	char *page = _memory_management_guard_pool + (2 * index + 1) * pageSize;
+	if (tries == MEMORY_MANAGEMENT_GUARD_SLOTS || 0 != mprotect(page, pageSize, PROT_READ | PROT_WRITE)) {
+		pthread_mutex_unlock(&_memory_management_guard_lock);
+		return NULL;
+	}
+	memset(page, 0, pageSize);
+	
+	struct _memory_management_guard_slot *slot = &_memory_management_guard_slots[index];
+	slot->state = _MemoryManagementGuardSlotLive;
+	slot->object = page + pageSize - alignedUserSize;
+	slot->size = userSize;
+	slot->allocStackDepth = backtrace(slot->allocStack, MEMORY_MANAGEMENT_GUARD_STACK_DEPTH);
+	slot->freeStackDepth = 0;
+	_memory_management_guard_next_slot = (index + 1) % MEMORY_MANAGEMENT_GUARD_SLOTS;
+	pthread_mutex_unlock(&_memory_management_guard_lock);
+	
+	return _MEMORY_MANAGEMENT_INTERNAL_CAST(slot->object);
+}
+
+static bool _memory_management_guard_free(_MEMORY_MANAGEMENT_INTERNAL_TYPE *object) {
+	char *address = (char *)object;
+	char *pool = _memory_management_guard_pool;
+	if (NULL == pool || address < pool || address >= pool + _memory_management_guard_pool_length)
+		return false;
+	
+	const size_t pageSize = _memory_management_guard_page_size;
+	const size_t index = ((size_t)(address - pool) / pageSize - 1) / 2;
+	struct _memory_management_guard_slot *slot = &_memory_management_guard_slots[index];
+	
+	pthread_mutex_lock(&_memory_management_guard_lock);
+	slot->freeStackDepth = backtrace(slot->freeStack, MEMORY_MANAGEMENT_GUARD_STACK_DEPTH);
+	slot->state = _MemoryManagementGuardSlotQuarantined;
+	mprotect(pool + (2 * index + 1) * pageSize, pageSize, PROT_NONE);
+	pthread_mutex_unlock(&_memory_management_guard_lock);
+	return true;
+}
+
+void memory_management_guard_set_sample_rate(unsigned int rate) {
+	if (0 != rate) {
+		pthread_mutex_lock(&_memory_management_guard_lock);
+		const bool ready = (NULL != _memory_management_guard_pool) || _memory_management_guard_initialize_pool();
+		pthread_mutex_unlock(&_memory_management_guard_lock);
+		if (!ready) {
+			errno = ENOMEM;
+			return;
+		}
+	}
+	_memory_management_guard_sample_rate = rate;
+}
+
+__attribute__((constructor))
+static void _memory_management_guard_initialize_from_environment(void) {
+	const char *value = getenv(_MEMORY_MANAGEMENT_GUARD_SAMPLE_RATE_VARIABLE);
+	if (NULL == value)
+		return;
+	
+	char *end = NULL;
+	const unsigned long rate = strtoul(value, &end, 10);
+	if (end == value || rate > UINT_MAX)
+		return;
+	memory_management_guard_set_sample_rate((unsigned int)rate);
+}
+
+/*!
+ *	@internal
+ *  @struct _memory_management_persistent_header
+ *	@brief The header at the start of a persistent domain file
+ *  @ingroup mm
+ *	@details All the positions are offsets from the start of the mapping. A
+ *	block is a memory management header followed by the user data, its size
+ *	is the power of two that fits the `size` of the header.
+ *	@endinternal
+ */
+struct _memory_management_persistent_header {
+	uint32_t magic; /*!< _MEMORY_MANAGEMENT_PERSISTENT_MAGIC */
+	uint32_t version; /*!< _MEMORY_MANAGEMENT_PERSISTENT_VERSION */
+	uintptr_t base; /*!< the address at which the file must be mapped */
+	size_t capacity; /*!< the size of the file */
+	size_t top; /*!< the end of the last block */
+	size_t root; /*!< the root object or 0 */
+	size_t freeLists[_MEMORY_MANAGEMENT_PERSISTENT_BINS]; /*!< the first free block of each size or 0 */
+};
+
+/*!
+ *	@internal
+ *  @struct _memory_management_persistent_domain
+ *	@brief An open persistent domain
+ *  @ingroup mm
+ *	@endinternal
+ */
+struct _memory_management_persistent_domain {
+	struct _memory_management_persistent_header *header; /*!< the mapping */
+	int fd; /*!< the backing file */
+	pthread_mutex_t lock; /*!< protects the free lists and top */
+};
+
+/*!
+ *	@internal
+ *  @struct _memory_management_persistent_range
+ *	@brief The addresses of an open persistent domain
+ *  @ingroup mm
+ *	@details The ranges are read without lock by every final release, `end`
+ *	is written last when a domain is opened and cleared first when it is
+ *	closed.
+ *	@endinternal
+ */
+struct _memory_management_persistent_range {
+	char *volatile base; /*!< the start of the mapping */
+	char *volatile end; /*!< the end of the mapping or `NULL` if the range is unused */
+	struct _memory_management_persistent_domain *volatile domain; /*!< the domain */
+};
+
+static struct _memory_management_persistent_range _memory_management_persistent_ranges[MEMORY_MANAGEMENT_PERSISTENT_DOMAINS];
+static volatile unsigned int _memory_management_persistent_domain_count = 0;
+static pthread_mutex_t _memory_management_persistent_domains_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK ((sizeof(struct _memory_management_persistent_header) + _MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE - 1) & ~((size_t)_MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE - 1))
+
+static unsigned int _memory_management_persistent_bin(size_t totalSize) {
+	unsigned int bin = 0;
+	while (((size_t)_MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE << bin) < totalSize)
+		bin++;
+	return bin;
+}
+
+static bool _memory_management_persistent_domain_walk(struct _memory_management_persistent_domain *domain, void (*function)(void *, void *), void *context, unsigned char *freeBlocks) {
+	struct _memory_management_persistent_header *header = domain->header;
+	char *base = (char *)header;
+	
+	if (_MEMORY_MANAGEMENT_PERSISTENT_MAGIC != header->magic || _MEMORY_MANAGEMENT_PERSISTENT_VERSION != header->version
+		|| (uintptr_t)base != header->base || header->top < _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK || header->top > header->capacity)
+		return false;
+	
+	bool rootFound = (0 == header->root);
+	size_t offset = _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK;
+	while (offset < header->top) {
+		_MEMORY_MANAGEMENT_DECLARE_INTERNAL_VARIABLE(object) = (_MEMORY_MANAGEMENT_INTERNAL_TYPE *)(base + offset);
+		if (object->size <= sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE))
+			return false;
+		const unsigned int bin = _memory_management_persistent_bin(object->size);
+		if (bin >= _MEMORY_MANAGEMENT_PERSISTENT_BINS)
+			return false;
+		const size_t blockSize = (size_t)_MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE << bin;
+		if (blockSize > header->top - offset)
+			return false;
+		
+		if (_MEMORY_MANAGEMENT_IS_INVALIDATED(object)) {
+			/* The root was being released when the process died */
+			rootFound = rootFound || (header->root == offset + sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE));
+			if (NULL != freeBlocks) {
+				const size_t granule = (offset - _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK) / _MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE;
+				freeBlocks[granule / CHAR_BIT] |= (unsigned char)(1U << (granule % CHAR_BIT));
+			}
+		}
+		else if (!_MEMORY_MANAGEMENT_CHECK_ENABLED(object) || 0 == _MEMORY_MANAGEMENT_RETAIN_COUNT_ATTRIBUTE(object))
+			return false;
+		else {
+			rootFound = rootFound || (header->root == offset + sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE));
+			if (NULL != function)
+				function(object, context);
+		}
+		
+		offset += blockSize;
+	}
+	return rootFound && offset == header->top;
+}
+
+/* Every link must be the start of a free block of its bin found by the walk,
+ each block is crossed out when visited so a cycle or a block shared by two
+ lists is caught. */
+static bool _memory_management_persistent_domain_check_free_lists(struct _memory_management_persistent_domain *domain, unsigned char *freeBlocks) {
+	struct _memory_management_persistent_header *header = domain->header;
+	char *base = (char *)header;
+	
+	for (unsigned int bin = 0; bin < _MEMORY_MANAGEMENT_PERSISTENT_BINS; bin++) {
+		size_t offset = header->freeLists[bin];
+		while (0 != offset) {
+			if (offset < _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK || offset >= header->top
+				|| 0 != (offset - _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK) % _MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE)
+				return false;
+			const size_t granule = (offset - _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK) / _MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE;
+			const unsigned char mask = (unsigned char)(1U << (granule % CHAR_BIT));
+			if (0 == (freeBlocks[granule / CHAR_BIT] & mask))
+				return false;
+			freeBlocks[granule / CHAR_BIT] &= (unsigned char)~mask;
+			
+			_MEMORY_MANAGEMENT_DECLARE_INTERNAL_VARIABLE(object) = (_MEMORY_MANAGEMENT_INTERNAL_TYPE *)(base + offset);
+			if (bin != _memory_management_persistent_bin(object->size))
+				return false;
+			offset = *(size_t *)(object+1);
+		}
+	}
+	return true;
+}
+
+/* Gives back the blocks left out of the free lists by a process that died
+ while allocating or releasing them, and a root that was being released. */
+static void _memory_management_persistent_domain_repair(struct _memory_management_persistent_domain *domain, const unsigned char *freeBlocks, size_t granules) {
+	struct _memory_management_persistent_header *header = domain->header;
+	char *base = (char *)header;
+	
+	if (0 != header->root && _MEMORY_MANAGEMENT_IS_INVALIDATED(_MEMORY_MANAGEMENT_INTERNAL_CAST(base + header->root)))
+		header->root = 0;
+	
+	for (size_t granule = 0; granule < granules; granule++) {
+		if (0 == (freeBlocks[granule / CHAR_BIT] & (1U << (granule % CHAR_BIT))))
+			continue;
+		const size_t offset = _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK + granule * _MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE;
+		_MEMORY_MANAGEMENT_DECLARE_INTERNAL_VARIABLE(object) = (_MEMORY_MANAGEMENT_INTERNAL_TYPE *)(base + offset);
+		const unsigned int bin = _memory_management_persistent_bin(object->size);
+		*(size_t *)(object+1) = header->freeLists[bin];
+		header->freeLists[bin] = offset;
+	}
+}
+
+/* Returns 0 or the errno describing why the domain cannot be used */
+static int _memory_management_persistent_domain_check(struct _memory_management_persistent_domain *domain, void (*function)(void *, void *), void *context, bool repair) {
+	struct _memory_management_persistent_header *header = domain->header;
+	if (header->top < _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK || header->top > header->capacity)
+		return EILSEQ;
+	
+	const size_t granules = (header->top - _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK) / _MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE;
+	unsigned char *freeBlocks = calloc(granules / CHAR_BIT + 1, 1);
+	if (NULL == freeBlocks)
+		return ENOMEM;
+	
+	const bool valid = _memory_management_persistent_domain_walk(domain, function, context, freeBlocks)
+		&& _memory_management_persistent_domain_check_free_lists(domain, freeBlocks);
+	if (valid && repair)
+		_memory_management_persistent_domain_repair(domain, freeBlocks, granules);
+	free(freeBlocks);
+	return valid ? 0 : EILSEQ;
+}
+
+static void _memory_management_persistent_domain_adopt(void *o, void *context) {
+	(void)context;
+	_MEMORY_MANAGEMENT_DECLARE_INTERNAL_VARIABLE(object) = o;
+	/* Functions do not survive a restart */
+	_MEMORY_MANAGEMENT_DEALLOC_ATTRIBUTE(object) = NULL;
+}
+
+static void _memory_management_persistent_domain_call(void *o, void *context) {
+	void **arguments = context;
+	void (*function)(void *, void *) = (void (*)(void *, void *))(uintptr_t)arguments[0];
+	function(((_MEMORY_MANAGEMENT_INTERNAL_TYPE *)o)+1, arguments[1]);
+}
+
+static bool _memory_management_persistent_domain_free(_MEMORY_MANAGEMENT_INTERNAL_TYPE *object) {
+	if (0 == _memory_management_persistent_domain_count)
+		return false;
+	
+	char *address = (char *)object;
+	struct _memory_management_persistent_domain *domain = NULL;
+	for (unsigned int index = 0; index < MEMORY_MANAGEMENT_PERSISTENT_DOMAINS && NULL == domain; index++) {
+		struct _memory_management_persistent_range *range = &_memory_management_persistent_ranges[index];
+		char *end = range->end;
+		__sync_synchronize();
+		if (NULL != end && address >= range->base && address < end)
+			domain = range->domain;
+	}
+	if (NULL == domain)
+		return false;
+	
+	pthread_mutex_lock(&domain->lock);
+	struct _memory_management_persistent_header *header = domain->header;
+	const unsigned int bin = _memory_management_persistent_bin(object->size);
+	const size_t offset = (size_t)(address - (char *)header);
+	if (header->root == offset + sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE))
+		header->root = 0;
+	*(size_t *)(object+1) = header->freeLists[bin];
+	header->freeLists[bin] = offset;
+	pthread_mutex_unlock(&domain->lock);
+	return true;
+}
+
+MemoryManagementPersistentDomain memory_management_persistent_domain_open(const char *path, size_t capacity, void *address) {
+#if NULLABILITY_CHECK
+    if (NULL==path) {
+        errno = EINVAL;
+        return NULL;
+    }
+#endif
+	const int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (-1 == fd)
+		return NULL;
+	
+	bool create = false;
+	struct _memory_management_persistent_header *header = MAP_FAILED;
+	/* Not a managed object: it must not depend on the allocator installed
+	 when the domain is closed. */
+	struct _memory_management_persistent_domain *domain = calloc(1, sizeof(struct _memory_management_persistent_domain));
+	if (NULL == domain) {
+		errno = ENOMEM;
+		goto error_close;
+	}
+	
+	/* Only one owner at a time. flock(2) belongs to the open file description:
+	 unlike a record lock it is not dropped when another descriptor of the
+	 same file is closed, and a second open in this process fails as well. */
+	struct stat status;
+	if (-1 == flock(fd, LOCK_EX | LOCK_NB) || -1 == fstat(fd, &status))
+		goto error_close;
+	
+	struct _memory_management_persistent_header fileHeader;
+	if (0 == status.st_size) {
+		const long pageSize = sysconf(_SC_PAGESIZE);
+		capacity = (capacity + (size_t)pageSize - 1) & ~((size_t)pageSize - 1);
+		if (capacity <= _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK) {
+			errno = EINVAL;
+			goto error_close;
+		}
+		/* From now on a failure must leave the file empty, a zero filled file
+		 would be rejected as corrupted by the next open. */
+		create = true;
+		if (0 != ftruncate(fd, (off_t)capacity))
+			goto error_close;
+	}
+	else {
+		if (sizeof(fileHeader) != pread(fd, &fileHeader, sizeof(fileHeader), 0)
+			|| _MEMORY_MANAGEMENT_PERSISTENT_MAGIC != fileHeader.magic
+			|| (off_t)fileHeader.capacity != status.st_size) {
+			errno = EILSEQ;
+			goto error_close;
+		}
+		capacity = fileHeader.capacity;
+		address = (void *)fileHeader.base;
+	}
+	
+	/* The objects point to each other, the file must come back at the same
+	 address. */
+	header = mmap(address, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == header)
+		goto error_close;
+	if (NULL != address && (void *)header != address) {
+		errno = EADDRNOTAVAIL;
+		goto error_close;
+	}
+	
+	if (create) {
+		header->magic = _MEMORY_MANAGEMENT_PERSISTENT_MAGIC;
+		header->version = _MEMORY_MANAGEMENT_PERSISTENT_VERSION;
+		header->base = (uintptr_t)header;
+		header->capacity = capacity;
+		header->top = _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK;
+	}
+	domain->header = header;
+	domain->fd = fd;
+	
+	const int checkError = create ? 0 : _memory_management_persistent_domain_check(domain, _memory_management_persistent_domain_adopt, NULL, true);
+	if (0 != checkError) {
+		errno = checkError;
+		goto error_close;
+	}
+	
+	pthread_mutex_lock(&_memory_management_persistent_domains_lock);
+	unsigned int index = 0;
+	while (index < MEMORY_MANAGEMENT_PERSISTENT_DOMAINS && NULL != _memory_management_persistent_ranges[index].end)
+		index++;
+	if (MEMORY_MANAGEMENT_PERSISTENT_DOMAINS == index) {
+		pthread_mutex_unlock(&_memory_management_persistent_domains_lock);
+		errno = EMFILE;
+		goto error_close;
+	}
+	pthread_mutex_init(&domain->lock, NULL);
+	_memory_management_persistent_ranges[index].base = (char *)header;
+	_memory_management_persistent_ranges[index].domain = domain;
+	__sync_synchronize();
+	_memory_management_persistent_ranges[index].end = (char *)header + capacity;
+	__sync_fetch_and_add(&_memory_management_persistent_domain_count, 1);
+	pthread_mutex_unlock(&_memory_management_persistent_domains_lock);
+	return domain;
+	
+error_close:
+	{
+		const int error = errno;
+		if (MAP_FAILED != header)
+			munmap(header, capacity);
+		/* Failing that, do not leave a zero filled file behind */
+		if (create && 0 != ftruncate(fd, 0))
+			unlink(path);
+		if (NULL != domain)
+			free(domain);
+		close(fd);
+		errno = error;
+	}
+	return NULL;
+}
+
+void *memory_management_persistent_domain_alloc(MemoryManagementPersistentDomain domain, size_t size) {
+#if NULLABILITY_CHECK
+    if (NULL==domain) {
+        errno = EINVAL;
+        return (void *)NULL;
+    }
+#endif
+	const size_t minimumAcceptedSize = (SIZE_MAX - sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE));
+    if (size == 0 || size >= minimumAcceptedSize) {
+        errno = EINVAL;
+        return (void *)NULL;
+    }
+	
+	const size_t totalSize = sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE) + size;
+	const unsigned int bin = _memory_management_persistent_bin(totalSize);
+	if (bin >= _MEMORY_MANAGEMENT_PERSISTENT_BINS) {
+		errno = ENOMEM;
+		return (void *)NULL;
+	}
+	const size_t blockSize = (size_t)_MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE << bin;
+	
+	/* The file must stay loadable if the process dies at any point: a block
+	 is published with a valid size and an invalidated canary, so until it is
+	 fully initialized it is only a leaked free block. */
+	pthread_mutex_lock(&domain->lock);
+	struct _memory_management_persistent_header *header = domain->header;
+	_MEMORY_MANAGEMENT_INTERNAL_TYPE *o = NULL;
+	size_t offset = header->freeLists[bin];
+	if (0 != offset) {
+		o = (_MEMORY_MANAGEMENT_INTERNAL_TYPE *)((char *)header + offset);
+		header->freeLists[bin] = *(size_t *)(o+1);
+	}
+	else if (blockSize <= header->capacity - header->top) {
+		o = (_MEMORY_MANAGEMENT_INTERNAL_TYPE *)((char *)header + header->top);
+		_MEMORY_MANAGEMENT_RETAIN_COUNT_ATTRIBUTE(o) = 0;
+		_MEMORY_MANAGEMENT_INVALIDATE(o);
+		_MEMORY_MANAGEMENT_DEALLOC_ATTRIBUTE(o) = NULL;
+		o->size = totalSize;
+		__sync_synchronize();
+		header->top += blockSize;
+	}
+	pthread_mutex_unlock(&domain->lock);
+	
+    if (NULL == o) {
+        errno = ENOMEM;
+        return (void *)NULL;
+    }
+	
+	memset(o+1, 0, blockSize - sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE));
+	_MEMORY_MANAGEMENT_RETAIN_COUNT_ATTRIBUTE(o) = 1;
+	_MEMORY_MANAGEMENT_DEALLOC_ATTRIBUTE(o) = NULL;
+	o->size = totalSize;
+	__sync_synchronize();
+	_MEMORY_MANAGEMENT_CANARY_ATTRIBUTE(o) = _MEMORY_MANAGEMENT_CANARY_VALUE;
+#ifdef STATS
+	pthread_mutex_lock(&guardian);
+	_total_live_memory += totalSize;
+	_total_memory_allocated += totalSize;
+	_total_allocations++;
+	pthread_mutex_unlock(&guardian);
+#endif
+	return o+1;
+}
+
+void memory_management_persistent_domain_set_root(MemoryManagementPersistentDomain domain, void *o) {
+#if NULLABILITY_CHECK
+    if (NULL==domain) {
+        errno = EINVAL;
+        return;
+    }
+#endif
+	struct _memory_management_persistent_header *header = domain->header;
+	char *address = (char *)o;
+	if (NULL != o && (address < (char *)header + _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK || address >= (char *)header + header->top)) {
+		errno = EFAULT;
+		return;
+	}
+	header->root = (NULL == o) ? 0 : (size_t)(address - (char *)header);
+}
+
+void *memory_management_persistent_domain_get_root(MemoryManagementPersistentDomain domain) {
+#if NULLABILITY_CHECK
+    if (NULL==domain) {
+        errno = EINVAL;
+        return NULL;
+    }
+#endif
+	struct _memory_management_persistent_header *header = domain->header;
+	return (0 == header->root) ? NULL : (char *)header + header->root;
+}
+
+bool memory_management_persistent_domain_verify(MemoryManagementPersistentDomain domain) {
+#if NULLABILITY_CHECK
+    if (NULL==domain) {
+        errno = EINVAL;
+        return false;
+    }
+#endif
+	pthread_mutex_lock(&domain->lock);
+	const int error = _memory_management_persistent_domain_check(domain, NULL, NULL, false);
+	pthread_mutex_unlock(&domain->lock);
+	if (0 != error)
+		errno = error;
+	return 0 == error;
+}
+
+void memory_management_persistent_domain_enumerate(MemoryManagementPersistentDomain domain, void (*function)(void *object, void *context), void *context) {
+#if NULLABILITY_CHECK
+    if (NULL==domain || NULL==function) {
+        errno = EINVAL;
+        return;
+    }
+#endif
+	void *arguments[2] = { (void *)(uintptr_t)function, context };
+	_memory_management_persistent_domain_walk(domain, _memory_management_persistent_domain_call, arguments, NULL);
+}
+
+void memory_management_persistent_domain_sync(MemoryManagementPersistentDomain domain) {
+#if NULLABILITY_CHECK
+    if (NULL==domain) {
+        errno = EINVAL;
+        return;
+    }
+#endif
+	msync(domain->header, domain->header->capacity, MS_SYNC);
+}
+
+void memory_management_persistent_domain_close(MemoryManagementPersistentDomain domain) {
+#if NULLABILITY_CHECK
+    if (NULL==domain) {
+        errno = EINVAL;
+        return;
+    }
+#endif
+	pthread_mutex_lock(&_memory_management_persistent_domains_lock);
+	for (unsigned int index = 0; index < MEMORY_MANAGEMENT_PERSISTENT_DOMAINS; index++) {
+		struct _memory_management_persistent_range *range = &_memory_management_persistent_ranges[index];
+		if (domain != range->domain || NULL == range->end)
+			continue;
+		range->end = NULL;
+		__sync_synchronize();
+		range->base = NULL;
+		range->domain = NULL;
+		__sync_fetch_and_sub(&_memory_management_persistent_domain_count, 1);
+	}
+	pthread_mutex_unlock(&_memory_management_persistent_domains_lock);
+	
+	const size_t capacity = domain->header->capacity;
+	msync(domain->header, capacity, MS_SYNC);
+	munmap(domain->header, capacity);
+	close(domain->fd);
+	pthread_mutex_destroy(&domain->lock);
+	free(domain);
+}
+
 void *memory_management_retain(void *o) {
 #if NULLABILITY_CHECK
     if (NULL==o) {
@@ -149,7 +959,8 @@ void memory_management_release(void *o) {
 		_total_deallocations++;
 		pthread_mutex_unlock(&guardian);
 #endif
-		free(object);
+		if (!_memory_management_guard_free(object) && !_memory_management_persistent_domain_free(object))
+			_memory_management_allocator_free(object, object->size);
 		return;
 	}
 }
@@ -223,7 +1034,12 @@ void *memory_management_alloc(size_t size) {
 	
 	/* Allocate the header plus the requested size */
 	const size_t totalSize = sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE) + size;
-	_MEMORY_MANAGEMENT_INTERNAL_TYPE *o = calloc(1,  totalSize);
+	_MEMORY_MANAGEMENT_INTERNAL_TYPE *o = NULL;
+	const unsigned int sampleRate = _memory_management_guard_sample_rate;
+	if (0 != sampleRate && _memory_management_guard_should_sample(sampleRate))
+		o = _memory_management_guard_alloc(totalSize);
+	if (NULL == o)
+		o = _memory_management_allocator_zeroed_alloc(totalSize);
     if (NULL==o) {
         errno = ENOMEM;
         return (void *)NULL;
@@ -269,7 +1085,7 @@ void *memory_management_copy(void *o, MemoryManagementDomain domain) {
 			copy = MEMORY_MANAGEMENT_ALLOC(userDataSize);
 			break;
 		case MemoryManagementDomainUnmanaged:
-			copy = malloc(1 * userDataSize);
+			copy = _memory_management_allocator.alloc(userDataSize, _memory_management_allocator.context);
 			break;
 			
 		default:
@@ -284,6 +1100,125 @@ void *memory_management_copy(void *o, MemoryManagementDomain domain) {
 	return copy;
 }
 
+size_t memory_management_get_size(const void *o) {
+#if NULLABILITY_CHECK
+    if (NULL==o) {
+        errno = EINVAL;
+        return 0;
+    }
+#endif
+	_MEMORY_MANAGEMENT_DECLARE_INTERNAL_VARIABLE(object) = _MEMORY_MANAGEMENT_INTERNAL_CAST(o);
+	
+	if (!_MEMORY_MANAGEMENT_CHECK_ENABLED(object) || _MEMORY_MANAGEMENT_IS_INVALIDATED(object)) {
+		errno = EFAULT;
+		return 0;
+	}
+	
+	return object->size - sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE);
+}
+
+MemoryManagementSlice memory_management_slice(void *buffer, size_t offset, size_t length) {
+	MemoryManagementSlice slice = { NULL, 0, 0 };
+#if NULLABILITY_CHECK
+    if (NULL==buffer) {
+        errno = EINVAL;
+        return slice;
+    }
+#endif
+	_MEMORY_MANAGEMENT_DECLARE_INTERNAL_VARIABLE(object) = _MEMORY_MANAGEMENT_INTERNAL_CAST(buffer);
+	if (!_MEMORY_MANAGEMENT_CHECK_ENABLED(object) || _MEMORY_MANAGEMENT_IS_INVALIDATED(object)) {
+		if (_MEMORY_MANAGEMENT_IS_INVALIDATED(object)) {
+			assert(0 && "Called slice() on invalided pointer.");
+		}
+		errno = EFAULT;
+		return slice;
+	}
+	
+	const size_t size = object->size - sizeof(_MEMORY_MANAGEMENT_INTERNAL_TYPE);
+	if (offset > size || length > size - offset) {
+		errno = EINVAL;
+		return slice;
+	}
+	
+	_MEMORY_MANAGEMENT_ATOMIC_RETAIN(object);
+	slice.buffer = buffer;
+	slice.offset = offset;
+	slice.length = length;
+	return slice;
+}
+
+MemoryManagementSlice memory_management_slice_subslice(MemoryManagementSlice slice, size_t offset, size_t length) {
+	MemoryManagementSlice subslice = { NULL, 0, 0 };
+	if (NULL == slice.buffer || offset > slice.length || length > slice.length - offset) {
+		errno = EINVAL;
+		return subslice;
+	}
+	
+	_MEMORY_MANAGEMENT_DECLARE_INTERNAL_VARIABLE(object) = _MEMORY_MANAGEMENT_INTERNAL_CAST(slice.buffer);
+	if (!_MEMORY_MANAGEMENT_CHECK_ENABLED(object) || _MEMORY_MANAGEMENT_IS_INVALIDATED(object)) {
+		if (_MEMORY_MANAGEMENT_IS_INVALIDATED(object)) {
+			assert(0 && "Called subslice() on invalided pointer.");
+		}
+		errno = EFAULT;
+		return subslice;
+	}
+	
+	/* Always retain the buffer itself, never a chain of slices */
+	_MEMORY_MANAGEMENT_ATOMIC_RETAIN(object);
+	subslice.buffer = slice.buffer;
+	subslice.offset = slice.offset + offset;
+	subslice.length = length;
+	return subslice;
+}
+
+MemoryManagementSlice memory_management_slice_retain(MemoryManagementSlice slice) {
+	if (NULL != slice.buffer)
+		memory_management_retain(slice.buffer);
+	return slice;
+}
+
+void memory_management_slice_release(MemoryManagementSlice slice) {
+	if (NULL != slice.buffer)
+		memory_management_release(slice.buffer);
+}
+
+void *memory_management_slice_copy(MemoryManagementSlice slice, MemoryManagementDomain domain) {
+	/* Like memory_management_alloc(), nothing of size 0 is allocated */
+	if (NULL == slice.buffer || 0 == slice.length || domain>MemoryManagementDomains) {
+		errno = EINVAL;
+		return (void *)NULL;
+	}
+	
+	_MEMORY_MANAGEMENT_DECLARE_INTERNAL_VARIABLE(object) = _MEMORY_MANAGEMENT_INTERNAL_CAST(slice.buffer);
+	if (!_MEMORY_MANAGEMENT_CHECK_ENABLED(object) || _MEMORY_MANAGEMENT_IS_INVALIDATED(object)) {
+		if (_MEMORY_MANAGEMENT_IS_INVALIDATED(object)) {
+			assert(0 && "Called slice_copy() on invalided pointer.");
+		}
+		errno = EFAULT;
+		return (void *)NULL;
+	}
+	
+	void *copy = NULL;
+	switch (domain) {
+		case MemoryManagementDomainManaged:
+			copy = MEMORY_MANAGEMENT_ALLOC(slice.length);
+			break;
+		case MemoryManagementDomainUnmanaged:
+			copy = _memory_management_allocator.alloc(slice.length, _memory_management_allocator.context);
+			break;
+			
+		default:
+			break;
+	}
+	
+	if (NULL==copy) {
+		errno = ENOMEM;
+		return (void *)NULL;
+	}
+	memcpy(copy, MEMORY_MANAGEMENT_SLICE_BYTES(slice), slice.length);
+	return copy;
+}
+
 void memory_management_print_stats() {
 #ifdef STATS
 	printf("==%d== HEAP SUMMARY:\n", getpid());
@@ -293,6 +1228,15 @@ void memory_management_print_stats() {
 }
 
 
+#undef _MEMORY_MANAGEMENT_GUARD_ALIGNMENT
+#undef _MEMORY_MANAGEMENT_GUARD_SAMPLE_RATE_VARIABLE
+
+#undef _MEMORY_MANAGEMENT_PERSISTENT_MAGIC
+#undef _MEMORY_MANAGEMENT_PERSISTENT_VERSION
+#undef _MEMORY_MANAGEMENT_PERSISTENT_MIN_BIN_SIZE
+#undef _MEMORY_MANAGEMENT_PERSISTENT_BINS
+#undef _MEMORY_MANAGEMENT_PERSISTENT_FIRST_BLOCK
+
 #undef _MEMORY_MANAGEMENT_CANARY_VALUE
 #undef _MEMORY_MANAGEMENT_CANARY_BAD_VALUE
 
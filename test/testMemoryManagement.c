@@ -9,14 +9,21 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>   /* pour le rint */
 #include <string.h> /* pour le memcpy */
 #include <time.h>   /* chronometrage */
 #include <libgen.h> /* pour basename */
 #include <sys/stat.h> /* pour mkdir */
+#include <sys/mman.h> /* mprotect */
 #include <sys/time.h> /* gettimeofday */
+#include <sys/wait.h> /* waitpid */
 #include <unistd.h>   /* pour getlogin */
 #include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
 #include "Point.h"
 
 double my_gettimeofday(){
@@ -28,6 +35,10 @@ double my_gettimeofday(){
 void *manyRetains(void *arg);
 void *manyReleases(void *arg);
 void testCopy();
+void testGuard();
+void testPersistentDomain();
+void testAllocator();
+void testSlice();
 
 #define TIMES 100000000
 
@@ -56,6 +67,10 @@ int main() {
 	release(p);
 	
 	testCopy();
+	testGuard();
+	testPersistentDomain();
+	testAllocator();
+	testSlice();
 	
 	memory_management_print_stats();
 	return 0;
@@ -83,12 +98,420 @@ void testCopy() {
 	Point *tryManagedCopyPoint = MEMORY_MANAGEMENT_COPY(unmanagedCopyPoint, MemoryManagementDomainManaged);
 	assert(tryManagedCopyPoint == NULL);
 	
-	free(unmanagedCopyPoint);
+	memory_management_free_unmanaged(unmanagedCopyPoint, sizeof(Point));
 	release(managedCopyPoint);
 	release(point);
 	release(point);
 }
 
+static sigjmp_buf testGuardRecovery;
+static volatile sig_atomic_t testGuardRecovering = 0;
+
+static void testGuardApplicationHandler(int sig, siginfo_t *info, void *context) {
+	(void)info, (void)context;
+	if (testGuardRecovering)
+		siglongjmp(testGuardRecovery, 1);
+	
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = SIG_DFL;
+	sigaction(sig, &action, NULL);
+}
+
+void testGuard() {
+	/* An application handler installed before the guard pages */
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = testGuardApplicationHandler;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGSEGV, &action, NULL);
+	sigaction(SIGBUS, &action, NULL);
+	
+	memory_management_guard_set_sample_rate(1);
+	
+	Point *point = allocatePoint(7, 8);
+	assert(point != NULL);
+	assert(point->x == 7 && point->y == 8);
+	assert(MEMORY_MANAGEMENT_GET_RETAIN_COUNT(retain(point)) == 2);
+	
+	Point *copy = MEMORY_MANAGEMENT_COPY(point, MemoryManagementDomainManaged);
+	assert(copy != NULL);
+	assert(copy->x == 7 && copy->y == 8);
+	release(copy);
+	
+	release(point);
+	release(point);
+	
+	/* Touching a released sampled object must crash */
+	Point *freed = allocatePoint(1, 2);
+	release(freed);
+	pid_t child = fork();
+	assert(child != -1);
+	if (child == 0) {
+		freed->x = 3;
+		_exit(0);
+	}
+	int status = 0;
+	waitpid(child, &status, 0);
+	assert(WIFSIGNALED(status));
+	
+	/* So must writing past the end of a sampled object */
+	Point *overflowed = allocatePoint(1, 2);
+	child = fork();
+	assert(child != -1);
+	if (child == 0) {
+		overflowed[1].x = 3;
+		_exit(0);
+	}
+	waitpid(child, &status, 0);
+	assert(WIFSIGNALED(status));
+	release(overflowed);
+	
+	/* A fault the application recovers from must not turn the reports off */
+	int reports[2];
+	assert(pipe(reports) == 0);
+	child = fork();
+	assert(child != -1);
+	if (child == 0) {
+		dup2(reports[1], STDERR_FILENO);
+		const long pageSize = sysconf(_SC_PAGESIZE);
+		void *page = NULL;
+		assert(posix_memalign(&page, (size_t)pageSize, (size_t)pageSize) == 0);
+		mprotect(page, (size_t)pageSize, PROT_NONE);
+		testGuardRecovering = 1;
+		if (sigsetjmp(testGuardRecovery, 1) == 0)
+			*(volatile char *)page = 1;
+		testGuardRecovering = 0;
+		
+		Point *stale = allocatePoint(1, 2);
+		release(stale);
+		stale->x = 3;
+		_exit(0);
+	}
+	close(reports[1]);
+	char report[4096] = { 0 };
+	size_t reportLength = 0;
+	ssize_t readLength;
+	while ((readLength = read(reports[0], report + reportLength, sizeof(report) - 1 - reportLength)) > 0)
+		reportLength += (size_t)readLength;
+	close(reports[0]);
+	waitpid(child, &status, 0);
+	assert(WIFSIGNALED(status));
+	assert(strstr(report, "GUARD: use-after-free") != NULL);
+	
+	memory_management_guard_set_sample_rate(0);
+}
+
+void testPersistentDomain() {
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/testMemoryManagement.%d.mm", (int)getpid());
+	unlink(path);
+	
+	MemoryManagementPersistentDomain domain = memory_management_persistent_domain_open(path, 1 << 16, NULL);
+	assert(domain != NULL);
+	assert(memory_management_persistent_domain_get_root(domain) == NULL);
+	
+	Point *point = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	assert(point != NULL);
+	assert(MEMORY_MANAGEMENT_ENABLED(point) != 0);
+	point->x = 42, point->y = 43;
+	retain(point);
+	memory_management_persistent_domain_set_root(domain, point);
+	
+	Point *temporary = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	assert(temporary != NULL);
+	release(temporary);
+	Point *reused = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	assert(reused == temporary);
+	assert(reused->x == 0 && reused->y == 0);
+	release(reused);
+	
+	Point *copy = MEMORY_MANAGEMENT_COPY(point, MemoryManagementDomainManaged);
+	assert(copy != NULL && copy->x == 42);
+	release(copy);
+	
+	assert(memory_management_persistent_domain_verify(domain));
+	
+	/* A failed reopen must not release the ownership of the file */
+	assert(memory_management_persistent_domain_open(path, 0, NULL) == NULL);
+	assert(errno == EWOULDBLOCK);
+	pid_t child = fork();
+	assert(child != -1);
+	if (child == 0)
+		_exit(memory_management_persistent_domain_open(path, 0, NULL) == NULL ? 0 : 1);
+	int childStatus = 0;
+	waitpid(child, &childStatus, 0);
+	assert(WIFEXITED(childStatus) && WEXITSTATUS(childStatus) == 0);
+	
+	memory_management_persistent_domain_close(domain);
+	
+	/* Adopt the objects again */
+	domain = memory_management_persistent_domain_open(path, 0, NULL);
+	assert(domain != NULL);
+	point = memory_management_persistent_domain_get_root(domain);
+	assert(point != NULL);
+	assert(point->x == 42 && point->y == 43);
+	assert(MEMORY_MANAGEMENT_GET_RETAIN_COUNT(point) == 2);
+	release(point);
+	release(point);
+	assert(memory_management_persistent_domain_get_root(domain) == NULL);
+	assert(memory_management_persistent_domain_verify(domain));
+	
+	Point *corrupted = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	assert(corrupted != NULL);
+	memory_management_persistent_domain_close(domain);
+	
+	/* Smash the canary of the last object */
+	int fd = open(path, O_RDWR);
+	assert(fd != -1);
+	const unsigned int garbage = 0x12345678;
+	struct stat status;
+	fstat(fd, &status);
+	char *file = malloc((size_t)status.st_size);
+	assert(pread(fd, file, (size_t)status.st_size, 0) == status.st_size);
+	off_t canary = 0;
+	while (canary < status.st_size && *(unsigned int *)(file + canary) != 0xCA11ACAB)
+		canary += sizeof(unsigned int);
+	assert(canary < status.st_size);
+	assert(pwrite(fd, &garbage, sizeof(garbage), canary) == sizeof(garbage));
+	free(file);
+	close(fd);
+	
+	domain = memory_management_persistent_domain_open(path, 0, NULL);
+	assert(domain == NULL);
+	assert(errno == EILSEQ);
+	unlink(path);
+	
+	/* A failed creation must not leave a corrupted file behind */
+	domain = memory_management_persistent_domain_open(path, 1 << 16, NULL);
+	assert(domain != NULL);
+	Point *occupied = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	assert(occupied != NULL);
+	const uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	char otherPath[sizeof(path) + 8];
+	snprintf(otherPath, sizeof(otherPath), "%s.other", path);
+	unlink(otherPath);
+	MemoryManagementPersistentDomain other = memory_management_persistent_domain_open(otherPath, 1 << 16, (void *)((uintptr_t)occupied & ~(pageSize - 1)));
+	assert(other == NULL);
+	assert(errno == EADDRNOTAVAIL);
+	other = memory_management_persistent_domain_open(otherPath, 1 << 16, NULL);
+	assert(other != NULL);
+	memory_management_persistent_domain_close(other);
+	release(occupied);
+	memory_management_persistent_domain_close(domain);
+	unlink(otherPath);
+	unlink(path);
+	
+	/* A free list leading into a live object is corruption */
+	domain = memory_management_persistent_domain_open(path, 1 << 16, NULL);
+	assert(domain != NULL);
+	Point *first = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	Point *second = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	char *live = memory_management_persistent_domain_alloc(domain, 64);
+	assert(first != NULL && second != NULL && live != NULL);
+	memory_management_persistent_domain_set_root(domain, live + 8);
+	assert(!memory_management_persistent_domain_verify(domain));
+	memory_management_persistent_domain_set_root(domain, live);
+	assert(memory_management_persistent_domain_verify(domain));
+	release(first);
+	release(second);
+	assert(memory_management_persistent_domain_verify(domain));
+	*(size_t *)second += (size_t)(live - (char *)first) + 8;
+	assert(!memory_management_persistent_domain_verify(domain));
+	assert(errno == EILSEQ);
+	memory_management_persistent_domain_close(domain);
+	domain = memory_management_persistent_domain_open(path, 0, NULL);
+	assert(domain == NULL);
+	assert(errno == EILSEQ);
+	unlink(path);
+	
+	/* A process that died while releasing objects leaves them invalidated
+	 but out of the free lists: the file must still load. */
+	domain = memory_management_persistent_domain_open(path, 1 << 16, NULL);
+	assert(domain != NULL);
+	Point *root = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	Point *leaked = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	assert(root != NULL && leaked != NULL);
+	memory_management_persistent_domain_set_root(domain, root);
+	memory_management_persistent_domain_close(domain);
+	
+	fd = open(path, O_RDWR);
+	assert(fd != -1);
+	const unsigned int invalidated = 0xDEADDEAD;
+	for (off_t offset = 0; offset < (1 << 16); offset += sizeof(unsigned int)) {
+		unsigned int value = 0;
+		assert(pread(fd, &value, sizeof(value), offset) == sizeof(value));
+		if (value == 0xCA11ACAB)
+			assert(pwrite(fd, &invalidated, sizeof(invalidated), offset) == sizeof(invalidated));
+	}
+	close(fd);
+	
+	domain = memory_management_persistent_domain_open(path, 0, NULL);
+	assert(domain != NULL);
+	assert(memory_management_persistent_domain_get_root(domain) == NULL);
+	assert(memory_management_persistent_domain_verify(domain));
+	Point *reclaimed = memory_management_persistent_domain_alloc(domain, sizeof(Point));
+	assert(reclaimed == root || reclaimed == leaked);
+	release(reclaimed);
+	memory_management_persistent_domain_close(domain);
+	unlink(path);
+}
+
+struct testAllocatorState {
+	int allocations;
+	int frees;
+	size_t allocatedSize;
+	size_t freedSize;
+	bool fail;
+};
+
+static void *testAllocatorAlloc(size_t size, void *context) {
+	struct testAllocatorState *state = context;
+	if (state->fail)
+		return NULL;
+	state->allocations++;
+	state->allocatedSize = size;
+	return malloc(size);
+}
+
+static void testAllocatorFree(void *pointer, void *context) {
+	(void)pointer, (void)context;
+	assert(0 && "sized_free should have been used");
+}
+
+static void testAllocatorSizedFree(void *pointer, size_t size, void *context) {
+	struct testAllocatorState *state = context;
+	state->frees++;
+	state->freedSize = size;
+	free(pointer);
+}
+
+void testAllocator() {
+	struct testAllocatorState state = { 0, 0, 0, 0, false };
+	struct mm_allocator allocator = { testAllocatorAlloc, NULL, testAllocatorFree, testAllocatorSizedFree, &state };
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/testMemoryManagement.%d.mm", (int)getpid());
+	unlink(path);
+	MemoryManagementPersistentDomain domain = memory_management_persistent_domain_open(path, 1 << 16, NULL);
+	assert(domain != NULL);
+	
+	memory_management_set_allocator(&allocator);
+	
+	/* The domain was opened with the default allocator */
+	memory_management_persistent_domain_close(domain);
+	unlink(path);
+	assert(state.frees == 0);
+	
+	Point *point = allocatePoint(1, 2);
+	assert(point != NULL);
+	assert(state.allocations == 1);
+	const size_t pointAllocatedSize = state.allocatedSize;
+	
+	Point *unmanagedCopyPoint = MEMORY_MANAGEMENT_COPY(point, MemoryManagementDomainUnmanaged);
+	assert(unmanagedCopyPoint != NULL);
+	assert(state.allocations == 2);
+	memory_management_free_unmanaged(unmanagedCopyPoint, sizeof(Point));
+	assert(state.frees == 1);
+	assert(state.freedSize == sizeof(Point));
+	
+	release(point);
+	assert(state.frees == 2);
+	assert(state.freedSize == pointAllocatedSize);
+	
+	state.fail = true;
+	errno = 0;
+	assert(MEMORY_MANAGEMENT_ALLOC(sizeof(Point)) == NULL);
+	assert(errno == ENOMEM);
+	
+	struct mm_allocator invalid = { NULL, NULL, NULL, NULL, NULL };
+	errno = 0;
+	memory_management_set_allocator(&invalid);
+	assert(errno == EINVAL);
+	
+	memory_management_set_allocator(NULL);
+	point = allocatePoint(3, 4);
+	assert(point != NULL);
+	assert(state.allocations == 2);
+	release(point);
+}
+
+void testSlice() {
+	char *frame = MEMORY_MANAGEMENT_ALLOC(16);
+	assert(frame != NULL);
+	assert(memory_management_get_size(frame) == 16);
+	memcpy(frame, "headerpayload!!", 16);
+	
+	MemoryManagementSlice payload = memory_management_slice(frame, 6, 10);
+	assert(payload.buffer == frame);
+	assert(MEMORY_MANAGEMENT_GET_RETAIN_COUNT(frame) == 2);
+	assert(memcmp(MEMORY_MANAGEMENT_SLICE_BYTES(payload), "payload!!", 10) == 0);
+	
+	MemoryManagementSlice word = memory_management_slice_subslice(payload, 0, 7);
+	assert(word.buffer == frame);
+	assert(MEMORY_MANAGEMENT_SLICE_BYTES(word) == frame + 6);
+	assert(MEMORY_MANAGEMENT_GET_RETAIN_COUNT(frame) == 3);
+	
+	MemoryManagementSlice invalid = memory_management_slice_subslice(payload, 4, 7);
+	assert(invalid.buffer == NULL);
+	invalid = memory_management_slice(frame, 17, 0);
+	assert(invalid.buffer == NULL);
+	
+	char *copy = memory_management_slice_copy(word, MemoryManagementDomainManaged);
+	assert(copy != NULL);
+	assert(memory_management_get_size(copy) == 7);
+	assert(memcmp(copy, "payload", 7) == 0);
+	release(copy);
+	
+	MemoryManagementSlice empty = memory_management_slice(frame, 16, 0);
+	assert(empty.buffer == frame);
+	errno = 0;
+	assert(memory_management_slice_copy(empty, MemoryManagementDomainManaged) == NULL);
+	assert(errno == EINVAL);
+	memory_management_slice_release(empty);
+	
+	release(frame);
+	memory_management_slice_release(payload);
+	assert(MEMORY_MANAGEMENT_GET_RETAIN_COUNT(frame) == 1);
+	assert(memcmp(MEMORY_MANAGEMENT_SLICE_BYTES(word), "payload", 7) == 0);
+	memory_management_slice_release(word);
+	
+	/* A stale slice must not touch the freed buffer. A persistent domain
+	 keeps freed blocks mapped with their invalidated header. */
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/testMemoryManagement.%d.mm", (int)getpid());
+	unlink(path);
+	MemoryManagementPersistentDomain domain = memory_management_persistent_domain_open(path, 1 << 16, NULL);
+	assert(domain != NULL);
+	char *persistent = memory_management_persistent_domain_alloc(domain, 16);
+	assert(persistent != NULL);
+	MemoryManagementSlice stale = memory_management_slice(persistent, 0, 16);
+	memory_management_slice_release(stale);
+	release(persistent);
+	
+	pid_t child = fork();
+	assert(child != -1);
+	if (child == 0) {
+		memory_management_slice_subslice(stale, 0, 8);
+		_exit(0);
+	}
+	int status = 0;
+	waitpid(child, &status, 0);
+	assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+	
+	child = fork();
+	assert(child != -1);
+	if (child == 0) {
+		memory_management_slice_copy(stale, MemoryManagementDomainUnmanaged);
+		_exit(0);
+	}
+	waitpid(child, &status, 0);
+	assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+	
+	memory_management_persistent_domain_close(domain);
+	unlink(path);
+}
+
 void *manyRetains(void *arg) {
 	double start, end;
 	Point *p = arg;